@@ -0,0 +1,197 @@
+// Copyright (c) 2016 Bas Geertsema <mail@basgeertsema.nl>
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// benchmark of union set iteration against hand-written loops over the same sets
+//
+// build with optimizations, e.g.
+//
+//     cmake -S . -B build -DCMAKE_BUILD_TYPE=Release && cmake --build build --target bench
+//     ./build/bench [entities]
+//
+// every walk sums a field of the matched components, such that the compiler cannot
+// remove the loop. the reported time is the fastest of a number of repetitions.
+
+#include "ecs.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace ecs;
+
+struct ComponentBase {
+    ComponentBase() = default;
+
+    ComponentBase(int id) noexcept
+        : Id{ id }
+    {
+    }
+
+    int Id{ 0 };
+
+    int id() const
+    {
+        return Id;
+    }
+
+    bool operator<(const ComponentBase& rhs) const
+    {
+        return Id < rhs.Id;
+    }
+};
+
+struct Transform : public ComponentBase {
+    using ComponentBase::ComponentBase;
+
+    float X{ 1 };
+    float Y{ 0 };
+    float Z{ 0 };
+};
+
+struct RigidBody : public ComponentBase {
+    using ComponentBase::ComponentBase;
+
+    float Mass{ 2 };
+};
+
+struct Sensor : public ComponentBase {
+    using ComponentBase::ComponentBase;
+
+    float Range{ 3 };
+};
+
+// prevents the compiler from optimizing the walks away
+volatile float sink = 0;
+
+// returns the fastest time of a number of repetitions of f, in milliseconds
+template <class F>
+double measure(F f)
+{
+    const int repetitions = 50;
+    auto best = std::chrono::steady_clock::duration::max();
+    for (int i = 0; i < repetitions; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        best = std::min(best, std::chrono::steady_clock::now() - start);
+    }
+    return std::chrono::duration<double, std::milli>(best).count();
+}
+
+void report(const char* name, double hand, double ecs)
+{
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << hand << std::setw(10) << ecs << std::setw(9) << std::setprecision(2)
+              << ecs / hand << "\n";
+}
+
+int main(int argc, char* argv[])
+{
+    const int count = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    // every entity has a transform, 3 out of 4 have a rigid body and 1 out of 100 has a sensor
+    component_set<Transform> transforms;
+    component_set<RigidBody> bodies;
+    component_set<Sensor> sensors;
+    std::mt19937 random{ 1 };
+    for (int id = 0; id < count; ++id) {
+        transforms.emplace_hint(transforms.end(), id);
+        if (random() % 4 != 0) {
+            bodies.emplace_hint(bodies.end(), id);
+        }
+        if (random() % 100 == 0) {
+            sensors.emplace_hint(sensors.end(), id);
+        }
+    }
+
+    std::cout << count << " transforms, " << bodies.size() << " rigid bodies, " << sensors.size() << " sensors\n\n";
+    std::cout << std::left << std::setw(28) << "walk (ms)" << std::right << std::setw(10) << "hand"
+              << std::setw(10) << "ecs" << std::setw(9) << "ratio" << "\n";
+
+    report("transforms",
+        measure([&] {
+            float sum = 0;
+            for (const auto& transform : transforms) {
+                sum += transform.X;
+            }
+            sink = sum;
+        }),
+        measure([&] {
+            float sum = 0;
+            for (auto entity : entities(transforms)) {
+                sum += get<Transform>(entity).X;
+            }
+            sink = sum;
+        }));
+
+    // a hand-written merge of two ordered sets
+    auto merge = [](const auto& lhs, const auto& rhs, auto&& f) {
+        auto x = lhs.begin();
+        auto y = rhs.begin();
+        while (x != lhs.end() && y != rhs.end()) {
+            if (x->Id < y->Id) {
+                ++x;
+            } else if (y->Id < x->Id) {
+                ++y;
+            } else {
+                f(*x, *y);
+                ++x;
+                ++y;
+            }
+        }
+    };
+
+    report("transforms, bodies",
+        measure([&] {
+            float sum = 0;
+            merge(transforms, bodies, [&sum](const Transform& transform, const RigidBody& body) {
+                sum += transform.X * body.Mass;
+            });
+            sink = sum;
+        }),
+        measure([&] {
+            float sum = 0;
+            for (auto entity : entities(transforms, bodies)) {
+                sum += get<Transform>(entity).X * get<RigidBody>(entity).Mass;
+            }
+            sink = sum;
+        }));
+
+    // the ecs walk gallops through the transforms, the hand-written merge does not
+    report("transforms, sensors",
+        measure([&] {
+            float sum = 0;
+            merge(transforms, sensors, [&sum](const Transform& transform, const Sensor& sensor) {
+                sum += transform.X * sensor.Range;
+            });
+            sink = sum;
+        }),
+        measure([&] {
+            float sum = 0;
+            for (auto entity : entities(transforms, sensors)) {
+                sum += get<Transform>(entity).X * get<Sensor>(entity).Range;
+            }
+            sink = sum;
+        }));
+
+    return 0;
+}
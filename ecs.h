@@ -62,6 +62,24 @@ inline auto entities_find(R id, T&... sets)
 {
     return ecs::union_find(id, sets...);
 }
+
+// resolves a list of ids at once, in a single forward pass per set.
+// returns an entity for each id in the order of the ids, of which
+// all component pointers are null if the entity was not found
+template <class R, class... T>
+inline auto entities_find_many(const R& ids, T&... sets)
+{
+    return ecs::union_find_many(ids, sets...);
+}
+
+// iterates all entities that have a component in at least one of the sets,
+// each entity exactly once and ordered by id. use get_if<T> on the
+// yielded entity as components of the other sets might be absent
+template <class... T>
+inline auto any_of(T&... sets)
+{
+    return ecs::union_any_of(sets...);
+}
 }
 
 #endif
\ No newline at end of file
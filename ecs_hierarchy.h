@@ -0,0 +1,353 @@
+// Copyright (c) 2016 Bas Geertsema <mail@basgeertsema.nl>
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef ECS_HIERARCHY_H_INCLUDED
+#define ECS_HIERARCHY_H_INCLUDED
+
+#include "union_set.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace ecs {
+
+// a single entity in a hierarchy
+template <class TId>
+struct hierarchy_node {
+    TId Id;
+
+    // the identifier of the parent entity, only valid if this is not a root
+    TId ParentId;
+
+    // the index of the parent in the hierarchy, or hierarchy<>::none for roots
+    std::size_t Parent;
+
+    // the number of ancestors, zero for roots
+    std::size_t Depth;
+
+    // the number of nodes in the subtree of this node, including the node itself
+    std::size_t Size;
+
+    TId id() const
+    {
+        return Id;
+    }
+};
+
+template <class TId>
+struct element_id<hierarchy_node<TId> > {
+    using type = TId;
+
+    type operator()(const hierarchy_node<TId>& x) const
+    {
+        return x.Id;
+    }
+};
+
+// a parent/child relationship between entities, e.g. for transform propagation.
+// the nodes are stored in a single array in depth-first order, such that parents are
+// always stored before their children and each subtree is a contiguous range. nodes
+// refer to their parent by index, so propagating values from parents to children is
+// a single forward pass over the array.
+//
+// like the ordered sets, inserting and erasing moves the nodes after the affected position,
+// which is a linear but cache-friendly operation. reparenting only moves the nodes between
+// the old and the new position of the subtree.
+//
+// as the nodes are not ordered by identifier, the hierarchy is joined with component sets
+// via join(), which resolves all nodes in a single pass per set and returns the entities
+// in hierarchy order. the identifiers are also kept in a sorted array, which only changes
+// when entities are inserted or erased, together with the index of their node, such that
+// join() never has to sort and does not modify the hierarchy.
+template <class TId = int>
+class hierarchy {
+public:
+    using id_type = TId;
+    using node_type = hierarchy_node<TId>;
+    using const_iterator = typename std::vector<node_type>::const_iterator;
+
+    static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+    // adds the entity as a root. returns false if the entity is already present
+    bool insert(id_type id)
+    {
+        if (contains(id)) {
+            return false;
+        }
+        std::vector<node_type> block{ node_type{ id, id_type{}, none, 0, 1 } };
+        auto position = insert_block(block, none);
+        insert_sorted_id(id);
+        reindex(position, nodes_.size());
+        return true;
+    }
+
+    // adds the entity as the last child of the parent. returns false if the
+    // entity is already present or if the parent is not present
+    bool insert(id_type id, id_type parent)
+    {
+        auto p = find(parent);
+        if (contains(id) || p == none) {
+            return false;
+        }
+        std::vector<node_type> block{ node_type{ id, id_type{}, none, 0, 1 } };
+        auto position = insert_block(block, p);
+        insert_sorted_id(id);
+        reindex(position, nodes_.size());
+        return true;
+    }
+
+    // removes the entity and all of its descendants
+    void erase(id_type id)
+    {
+        auto x = find(id);
+        if (x == none) {
+            return;
+        }
+        auto block = extract_block(x);
+        std::vector<id_type> erased;
+        erased.reserve(block.size());
+        for (const auto& node : block) {
+            index_.erase(node.Id);
+            erased.push_back(node.Id);
+        }
+        erase_sorted_ids(erased);
+        reindex(x, nodes_.size());
+    }
+
+    // makes the entity a root, including its descendants
+    bool set_parent(id_type id)
+    {
+        auto x = find(id);
+        if (x == none) {
+            return false;
+        }
+        move_block(x, none);
+        return true;
+    }
+
+    // moves the entity, including its descendants, to become the last child of the parent.
+    // returns false if either is not present or if the parent is a descendant of the entity
+    bool set_parent(id_type id, id_type parent)
+    {
+        auto x = find(id);
+        auto p = find(parent);
+        if (x == none || p == none || (p >= x && p < x + nodes_[x].Size)) {
+            return false;
+        }
+        move_block(x, p);
+        return true;
+    }
+
+    // returns the index of the entity in the hierarchy, or none if it is not present
+    std::size_t find(id_type id) const
+    {
+        auto it = index_.find(id);
+        return it != index_.end() ? it->second : none;
+    }
+
+    bool contains(id_type id) const
+    {
+        return index_.count(id) != 0;
+    }
+
+    const node_type& operator[](std::size_t index) const
+    {
+        return nodes_[index];
+    }
+
+    const_iterator begin() const { return nodes_.begin(); }
+    const_iterator end() const { return nodes_.end(); }
+    std::size_t size() const { return nodes_.size(); }
+    bool empty() const { return nodes_.empty(); }
+
+    void clear()
+    {
+        nodes_.clear();
+        ids_.clear();
+        sorted_ids_.clear();
+        index_.clear();
+        order_.clear();
+    }
+
+    // resolves the components of every node in the given sets. element i of the result
+    // holds the components of node i, such that the parent of element i is found at
+    // element (*this)[i].Parent. if a node is not present in all sets, then all pointers
+    // of its element are null
+    template <class... TSet>
+    auto join(TSet&... sets) const
+    {
+        return union_find_many_query<TSet...>::resolve(ids_, order_, sets...);
+    }
+
+private:
+    // removes the subtree at the index from the array and returns it. the indices
+    // of the nodes after the subtree must be updated with reindex() afterwards
+    std::vector<node_type> extract_block(std::size_t x)
+    {
+        auto size = nodes_[x].Size;
+        for (auto p = nodes_[x].Parent; p != none; p = nodes_[p].Parent) {
+            nodes_[p].Size -= size;
+        }
+
+        std::vector<node_type> block(nodes_.begin() + x, nodes_.begin() + x + size);
+        nodes_.erase(nodes_.begin() + x, nodes_.begin() + x + size);
+        return block;
+    }
+
+    // inserts a subtree as the last child of the parent at the given index and returns
+    // its position. the indices of the nodes from that position onwards must be updated
+    // with reindex() afterwards
+    std::size_t insert_block(std::vector<node_type>& block, std::size_t parent)
+    {
+        auto size = block.size();
+        auto position = parent == none ? nodes_.size() : parent + nodes_[parent].Size;
+        auto depth = parent == none ? 0 : nodes_[parent].Depth + 1;
+
+        auto delta = depth - block.front().Depth;
+        for (auto& x : block) {
+            x.Depth += delta;
+        }
+        if (parent != none) {
+            block.front().ParentId = nodes_[parent].Id;
+        }
+        for (auto p = parent; p != none; p = nodes_[p].Parent) {
+            nodes_[p].Size += size;
+        }
+
+        nodes_.insert(nodes_.begin() + position, block.begin(), block.end());
+        return position;
+    }
+
+    // moves the subtree at the index to become the last child of the parent by rotating it
+    // in place. only the nodes between the old and the new position of the subtree change
+    // their index
+    void move_block(std::size_t x, std::size_t parent)
+    {
+        auto size = nodes_[x].Size;
+        auto target = parent == none ? nodes_.size() : parent + nodes_[parent].Size;
+        auto depth = parent == none ? 0 : nodes_[parent].Depth + 1;
+
+        for (auto p = nodes_[x].Parent; p != none; p = nodes_[p].Parent) {
+            nodes_[p].Size -= size;
+        }
+        for (auto p = parent; p != none; p = nodes_[p].Parent) {
+            nodes_[p].Size += size;
+        }
+
+        auto delta = depth - nodes_[x].Depth;
+        for (auto i = x; i < x + size; ++i) {
+            nodes_[i].Depth += delta;
+        }
+        if (parent != none) {
+            nodes_[x].ParentId = nodes_[parent].Id;
+        }
+
+        auto first = nodes_.begin();
+        if (target > x) {
+            std::rotate(first + x, first + x + size, first + target);
+            reindex(x, target);
+        } else {
+            std::rotate(first + target, first + x, first + x + size);
+            reindex(target, x + size);
+        }
+    }
+
+    // updates the indices of the nodes in the range [from, to), of which the position
+    // has changed, and the parent indices of all nodes from that range onwards
+    void reindex(std::size_t from, std::size_t to)
+    {
+        ids_.resize(nodes_.size());
+        for (auto i = from; i < to; ++i) {
+            const auto& id = nodes_[i].Id;
+            ids_[i] = id;
+            index_[id] = i;
+            order_[static_cast<std::size_t>(std::lower_bound(sorted_ids_.begin(), sorted_ids_.end(), id) - sorted_ids_.begin())] = i;
+        }
+
+        // in depth-first order the parent of a node is the last node before it that is
+        // one level up, so the parent indices follow from a single pass with a stack of
+        // the current ancestors. the ancestors of the first node are before the range
+        if (from >= nodes_.size()) {
+            return;
+        }
+        std::vector<std::size_t> ancestors(nodes_[from].Depth);
+        auto p = nodes_[from].Depth == 0 ? none : index_.find(nodes_[from].ParentId)->second;
+        for (auto depth = ancestors.size(); depth > 0; --depth, p = nodes_[p].Parent) {
+            ancestors[depth - 1] = p;
+        }
+        for (auto i = from; i < nodes_.size(); ++i) {
+            auto& x = nodes_[i];
+            ancestors.resize(x.Depth);
+            x.Parent = x.Depth == 0 ? none : ancestors.back();
+            ancestors.push_back(i);
+        }
+    }
+
+    // inserts the identifier, the index of its node is set by reindex()
+    void insert_sorted_id(id_type id)
+    {
+        auto rank = std::lower_bound(sorted_ids_.begin(), sorted_ids_.end(), id) - sorted_ids_.begin();
+        sorted_ids_.insert(sorted_ids_.begin() + rank, id);
+        order_.insert(order_.begin() + rank, none);
+    }
+
+    // removes the identifiers with a single pass over the sorted identifiers
+    void erase_sorted_ids(std::vector<id_type>& ids)
+    {
+        std::sort(ids.begin(), ids.end());
+        auto erased = ids.begin();
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < sorted_ids_.size(); ++i) {
+            erased = std::lower_bound(erased, ids.end(), sorted_ids_[i]);
+            if (erased == ids.end() || sorted_ids_[i] < *erased) {
+                sorted_ids_[kept] = sorted_ids_[i];
+                order_[kept] = order_[i];
+                ++kept;
+            }
+        }
+        sorted_ids_.resize(kept);
+        order_.resize(kept);
+    }
+
+    std::vector<node_type> nodes_;
+
+    // the identifiers of the nodes, in the same order as the nodes
+    std::vector<id_type> ids_;
+
+    // the identifiers of the nodes in ascending order, only changed by insert and erase
+    std::vector<id_type> sorted_ids_;
+
+    std::unordered_map<id_type, std::size_t> index_;
+
+    // the index of the node of each identifier in sorted_ids_, i.e. the permutation that
+    // sorts ids_. it is kept up to date by reindex(), such that join() is read-only and can
+    // be called concurrently
+    std::vector<std::size_t> order_;
+};
+
+template <class TId>
+constexpr std::size_t hierarchy<TId>::none;
+}
+
+#endif
@@ -0,0 +1,493 @@
+// Copyright (c) 2016 Bas Geertsema <mail@basgeertsema.nl>
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef ECS_REGISTRY_H_INCLUDED
+#define ECS_REGISTRY_H_INCLUDED
+
+// operations that work on all component sets of a world at once
+//
+// component sets are normally independent containers. for operations that must
+// touch every set, such as renumbering entity ids or memory accounting, the sets are
+// registered in a component_registry, which holds references to the sets (not the sets themselves).
+
+#include "union_set.h"
+
+#include "ecs_flatset.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// functor to change the common identifier of a set element
+// by default it calls the set_id() function on an object
+//
+// NOTE TO APPLICATION DEVELOPERS:
+//
+// this is only required for operations that renumber entities, such as compact_ids.
+// you can either implement the set_id() function on your element types or
+// specialize this struct for your element type
+template <class T>
+struct assign_element_id {
+    template <class TId>
+    void operator()(T& x, const TId& id) const
+    {
+        x.set_id(id);
+    }
+};
+
+// the renumbering of entity identifiers as performed by compact_ids
+template <class TId>
+class id_mapping {
+public:
+    using id_type = TId;
+
+    id_mapping() = default;
+
+    // old_ids must be sorted, new_ids holds the new identifier for each old identifier
+    id_mapping(std::vector<id_type> old_ids, std::vector<id_type> new_ids)
+        : old_ids_{ std::move(old_ids) },
+          new_ids_{ std::move(new_ids) }
+    {
+        assert(old_ids_.size() == new_ids_.size());
+    }
+
+    // returns a pointer to the new identifier, or a nullptr if the identifier is unknown
+    const id_type* find(const id_type& old_id) const
+    {
+        auto it = std::lower_bound(old_ids_.begin(), old_ids_.end(), old_id);
+        if (it == old_ids_.end() || old_id < *it) {
+            return nullptr;
+        }
+        return &new_ids_[static_cast<std::size_t>(it - old_ids_.begin())];
+    }
+
+    // returns the new identifier of an identifier that is known to be mapped
+    id_type operator()(const id_type& old_id) const
+    {
+        auto x = find(old_id);
+        assert(x != nullptr);
+        return *x;
+    }
+
+    // whether new identifiers are in the same order as the old identifiers,
+    // in that case the sets remain ordered after renumbering
+    bool preserves_order() const
+    {
+        return std::is_sorted(new_ids_.begin(), new_ids_.end());
+    }
+
+    std::size_t size() const
+    {
+        return old_ids_.size();
+    }
+
+    // the old identifiers in ascending order
+    const std::vector<id_type>& old_ids() const
+    {
+        return old_ids_;
+    }
+
+    // the new identifier of each identifier in old_ids()
+    const std::vector<id_type>& new_ids() const
+    {
+        return new_ids_;
+    }
+
+private:
+    std::vector<id_type> old_ids_;
+    std::vector<id_type> new_ids_;
+};
+
+// the memory used by a single component set
+struct component_memory {
+    // the (demangled) name of the component type
+    std::string name;
+
+    std::size_t element_size{ 0 };
+    std::size_t size{ 0 };
+    std::size_t capacity{ 0 };
+
+    // bytes used by the components in the set
+    std::size_t bytes_live() const
+    {
+        return size * element_size;
+    }
+
+    // bytes allocated for the components in the set
+    std::size_t bytes_capacity() const
+    {
+        return capacity * element_size;
+    }
+
+    // bytes allocated but not used by components
+    std::size_t bytes_overhead() const
+    {
+        return bytes_capacity() - bytes_live();
+    }
+};
+
+// the memory used by all component sets of a registry
+struct memory_report {
+    std::vector<component_memory> components;
+
+    std::size_t bytes_live() const
+    {
+        std::size_t total = 0;
+        for (const auto& x : components) {
+            total += x.bytes_live();
+        }
+        return total;
+    }
+
+    std::size_t bytes_capacity() const
+    {
+        std::size_t total = 0;
+        for (const auto& x : components) {
+            total += x.bytes_capacity();
+        }
+        return total;
+    }
+
+    std::size_t bytes_overhead() const
+    {
+        return bytes_capacity() - bytes_live();
+    }
+};
+
+// determines the capacity of the component sets at sync points, see
+// component_registry::apply_capacity_policy. component sets only grow
+// by themselves, so without a policy they keep their peak capacity forever
+struct capacity_policy {
+    // the capacity that is reserved for a set relative to its size, such that
+    // a set can grow between sync points without reallocating ..
+    double growth_factor{ 1.5 };
+
+    // .. which is only restored once less than this fraction of the reserved room
+    // for growth is left, such that a set is not copied to gain a few elements
+    double grow_threshold{ 0.5 };
+
+    // a set is shrunk back to size * growth_factor once its capacity exceeds
+    // size * growth_factor * shrink_threshold ..
+    double shrink_threshold{ 2.0 };
+
+    // .. for this number of consecutive sync points, such that a set that
+    // fluctuates in size is not reallocated over and over again
+    unsigned shrink_delay{ 8 };
+
+    // sets never shrink below this number of elements
+    std::size_t min_capacity{ 16 };
+};
+
+// holds references to all component sets of a world. the sets must outlive the registry
+template <class TId = int>
+class component_registry {
+public:
+    using id_type = TId;
+    using mapping_type = id_mapping<id_type>;
+
+    // registers a component set
+    template <class T>
+    void add(boost::container::flat_set<T>& set)
+    {
+        sets_.push_back(std::make_unique<flat_set_handle<T> >(set, nullptr));
+    }
+
+    // registers a component set, of which the components contain fields that refer to
+    // other entities. the hook is called for each component after the entities have
+    // been renumbered, such that it can rewrite those fields using the mapping
+    template <class T, class F>
+    void add(boost::container::flat_set<T>& set, F&& remap_fields)
+    {
+        sets_.push_back(std::make_unique<flat_set_handle<T> >(set, std::forward<F>(remap_fields)));
+    }
+
+    std::size_t size() const
+    {
+        return sets_.size();
+    }
+
+    // returns the memory that is used by each registered set
+    memory_report memory() const
+    {
+        memory_report result;
+        result.components.reserve(sets_.size());
+        for (const auto& x : sets_) {
+            result.components.push_back(x->memory());
+        }
+        return result;
+    }
+
+    // sets the capacity policy of all registered sets
+    void set_capacity_policy(const capacity_policy& policy)
+    {
+        for (const auto& x : sets_) {
+            x->policy = policy;
+        }
+    }
+
+    // sets the capacity policy of the registered sets with components of type T
+    template <class T>
+    void set_capacity_policy(const capacity_policy& policy)
+    {
+        for (const auto& x : sets_) {
+            if (dynamic_cast<flat_set_handle<T>*>(x.get()) != nullptr) {
+                x->policy = policy;
+            }
+        }
+    }
+
+    // grows or shrinks the capacity of all registered sets according to their policy.
+    // call this at a sync point, e.g. at the end of a frame, as reallocating a set
+    // invalidates all iterators and references to its components.
+    // returns the number of sets that have been reallocated
+    std::size_t apply_capacity_policy()
+    {
+        std::size_t count = 0;
+        for (const auto& x : sets_) {
+            count += x->apply_capacity_policy() ? 1 : 0;
+        }
+        return count;
+    }
+
+    // returns all identifiers that are present in any of the sets, in ascending order
+    std::vector<id_type> ids() const
+    {
+        std::vector<id_type> result;
+        std::vector<id_type> ids;
+        std::vector<id_type> merged;
+        for (const auto& x : sets_) {
+            ids.clear();
+            x->collect_ids(ids);
+            merged.clear();
+            merged.reserve(result.size() + ids.size());
+            std::set_union(result.begin(), result.end(), ids.begin(), ids.end(), std::back_inserter(merged));
+            result.swap(merged);
+        }
+        return result;
+    }
+
+    // renumbers the identifiers of all components in all sets. the new identifiers
+    // of the mapping must be the dense range that starts at first_id, as produced by compact_ids
+    void remap_ids(const mapping_type& mapping, id_type first_id)
+    {
+        auto preserves_order = mapping.preserves_order();
+        std::vector<std::size_t> slots;
+        for (const auto& x : sets_) {
+            x->remap_ids(mapping, preserves_order, first_id, slots);
+        }
+    }
+
+private:
+    struct set_handle {
+        virtual ~set_handle() = default;
+        virtual void collect_ids(std::vector<id_type>& ids) const = 0;
+        virtual void remap_ids(const mapping_type& mapping, bool preserves_order, id_type first_id, std::vector<std::size_t>& slots) = 0;
+        virtual component_memory memory() const = 0;
+        virtual bool apply_capacity_policy() = 0;
+
+        capacity_policy policy;
+
+        // number of consecutive sync points at which the set was over capacity
+        unsigned over_capacity{ 0 };
+    };
+
+    template <class T>
+    struct flat_set_handle : set_handle {
+        using set_type = boost::container::flat_set<T>;
+        using hook_type = std::function<void(T&, const mapping_type&)>;
+
+        flat_set_handle(set_type& set, hook_type hook)
+            : set_{ set },
+              hook_{ std::move(hook) }
+        {
+        }
+
+        void collect_ids(std::vector<id_type>& ids) const override
+        {
+            ids.reserve(set_.size());
+            for (const auto& x : set_) {
+                ids.push_back(get_element_id(x));
+            }
+        }
+
+        // both the set and the old identifiers of the mapping are ordered, so the new
+        // identifiers are found by a single forward walk. if the mapping changes the order,
+        // the elements are placed by their new identifier, which is dense, in a slot table
+        // shared by all sets. the cost is linear in the size of the set plus the mapping
+        void remap_ids(const mapping_type& mapping, bool preserves_order, id_type first_id, std::vector<std::size_t>& slots) override
+        {
+            auto sequence = set_.extract_sequence();
+            const auto& old_ids = mapping.old_ids();
+            const auto& new_ids = mapping.new_ids();
+
+            std::size_t rank = 0;
+            for (auto& x : sequence) {
+                auto id = get_element_id(x);
+                while (rank < old_ids.size() && old_ids[rank] < id) {
+                    ++rank;
+                }
+                assert(rank < old_ids.size() && !(id < old_ids[rank]));
+                assign_element_id<T>{}(x, new_ids[rank]);
+                if (hook_) {
+                    hook_(x, mapping);
+                }
+            }
+
+            if (preserves_order) {
+                set_.adopt_sequence(boost::container::ordered_unique_range, std::move(sequence));
+                return;
+            }
+
+            // new identifiers are dense, so they index the slot table relative to the first one
+            const auto none = sequence.size();
+            slots.assign(mapping.size(), none);
+            for (std::size_t i = 0; i < sequence.size(); ++i) {
+                slots[static_cast<std::size_t>(get_element_id(sequence[i]) - first_id)] = i;
+            }
+
+            typename set_type::sequence_type ordered;
+            ordered.reserve(sequence.size());
+            for (auto i : slots) {
+                if (i != none) {
+                    ordered.push_back(std::move(sequence[i]));
+                }
+            }
+            set_.adopt_sequence(boost::container::ordered_unique_range, std::move(ordered));
+        }
+
+        component_memory memory() const override
+        {
+            component_memory result;
+            result.name = meta::type_name(typeid(T));
+            result.element_size = sizeof(T);
+            result.size = set_.size();
+            result.capacity = set_.capacity();
+            return result;
+        }
+
+        bool apply_capacity_policy() override
+        {
+            const auto& policy = this->policy;
+            auto target = std::max(policy.min_capacity, static_cast<std::size_t>(static_cast<double>(set_.size()) * policy.growth_factor));
+
+            auto room = static_cast<double>(set_.capacity()) - static_cast<double>(set_.size());
+            auto reserved_room = static_cast<double>(target) - static_cast<double>(set_.size());
+            if (set_.capacity() < target && room < reserved_room * policy.grow_threshold) {
+                this->over_capacity = 0;
+                set_.reserve(target);
+                return true;
+            }
+
+            if (static_cast<double>(set_.capacity()) <= static_cast<double>(target) * policy.shrink_threshold) {
+                this->over_capacity = 0;
+                return false;
+            }
+            if (++this->over_capacity < policy.shrink_delay) {
+                return false;
+            }
+
+            // move the components to a new sequence, which is allocated with the target
+            // capacity directly rather than via shrink_to_fit followed by reserve
+            this->over_capacity = 0;
+            auto sequence = set_.extract_sequence();
+            typename set_type::sequence_type resized;
+            resized.reserve(target);
+            resized.insert(resized.end(), std::make_move_iterator(sequence.begin()), std::make_move_iterator(sequence.end()));
+            set_.adopt_sequence(boost::container::ordered_unique_range, std::move(resized));
+            return true;
+        }
+
+        set_type& set_;
+        hook_type hook_;
+    };
+
+    std::vector<std::unique_ptr<set_handle> > sets_;
+};
+
+// ordering for compact_ids that keeps the entities in their current order
+struct keep_id_order {
+};
+
+namespace registry_detail {
+    template <class TId, class F>
+    std::vector<TId> compact_new_ids(const std::vector<TId>& old_ids, TId first_id, F&&, std::true_type)
+    {
+        std::vector<TId> result(old_ids.size());
+        for (std::size_t i = 0; i < result.size(); ++i) {
+            result[i] = static_cast<TId>(first_id + static_cast<TId>(i));
+        }
+        return result;
+    }
+
+    template <class TId, class F>
+    std::vector<TId> compact_new_ids(const std::vector<TId>& old_ids, TId first_id, F&& ordering, std::false_type)
+    {
+        // rank the entities by their key, ties keep their current order
+        using key_type = std::decay_t<decltype(ordering(old_ids.front()))>;
+        std::vector<std::pair<key_type, std::size_t> > keys;
+        keys.reserve(old_ids.size());
+        for (std::size_t i = 0; i < old_ids.size(); ++i) {
+            keys.emplace_back(ordering(old_ids[i]), i);
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<TId> result(old_ids.size());
+        for (std::size_t rank = 0; rank < keys.size(); ++rank) {
+            result[keys[rank].second] = static_cast<TId>(first_id + static_cast<TId>(rank));
+        }
+        return result;
+    }
+}
+
+// renumbers all entities in the registered sets to the dense range of identifiers that
+// starts at first_id, such that entities are close together in every set and the range
+// of identifiers does not grow without bound. the ordering is either keep_id_order or a
+// function that returns a sortable key for an (old) entity identifier, e.g. its spatial
+// cell, such that entities that are processed together end up next to each other.
+// returns the mapping from the old to the new identifiers, which can be used to
+// update any identifiers that are stored outside of the registered sets
+template <class TId, class F = keep_id_order>
+id_mapping<TId> compact_ids(component_registry<TId>& registry, F&& ordering = F{}, TId first_id = TId{ 0 })
+{
+    auto old_ids = registry.ids();
+    if (old_ids.empty()) {
+        return {};
+    }
+    auto new_ids = registry_detail::compact_new_ids(old_ids, first_id, std::forward<F>(ordering),
+        std::is_same<std::decay_t<F>, keep_id_order>{});
+    id_mapping<TId> mapping{ std::move(old_ids), std::move(new_ids) };
+    registry.remap_ids(mapping, first_id);
+    return mapping;
+}
+}
+
+#endif
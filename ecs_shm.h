@@ -0,0 +1,543 @@
+// Copyright (c) 2016 Bas Geertsema <mail@basgeertsema.nl>
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef ECS_SHM_H_INCLUDED
+#define ECS_SHM_H_INCLUDED
+
+// component sets that live in a POSIX shared memory segment, such that
+// out-of-process tools (profilers, debug viewers, ..) can inspect a live world
+// without the simulation having to serialize and send its state.
+//
+// the simulation owns a shm_component_set<T>, which behaves like an ordered set
+// with a fixed capacity. tools open the same segment read-only with a
+// shm_component_reader<T> and iterate it with entities(...) like any other set.
+//
+// consistency is guaranteed by a sequence lock: the writer makes the sequence
+// number odd while it modifies the set and even again when it is done. readers
+// never block the writer, instead they retry their read if the sequence number
+// changed in the mean time. the only cost for the simulation is two atomic stores
+// per write scope.
+//
+// a reader only succeeds in between write scopes, so the writer should keep its
+// scopes short. readers give up after a timeout, e.g. when the writer crashed
+// within a scope.
+//
+// this header requires a POSIX system and only supports trivially copyable components.
+
+#include "union_set.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ecs {
+
+namespace shm {
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory sets require lock-free 64-bit atomics");
+
+    // identifies a segment created by shm_component_set
+    constexpr std::uint64_t segment_magic = 0x45435353484d3031ull; // "ECSSHM01"
+
+    // the header at the start of each segment, followed by the elements
+    struct segment_header {
+        std::uint64_t magic;
+        std::uint64_t element_size;
+        std::uint64_t capacity;
+        std::atomic<std::uint64_t> sequence;
+        std::atomic<std::uint64_t> size;
+    };
+
+    // offset of the first element in the segment, suitably aligned for T
+    template <class T>
+    constexpr std::size_t data_offset()
+    {
+        return (sizeof(segment_header) + alignof(T) - 1) / alignof(T) * alignof(T);
+    }
+
+    template <class T>
+    constexpr std::size_t segment_size(std::size_t capacity)
+    {
+        return data_offset<T>() + capacity * sizeof(T);
+    }
+
+    // tag to replace an existing segment with the same name, see shm_component_set
+    struct replace_existing_t {
+    };
+
+    constexpr replace_existing_t replace_existing{};
+
+    // the time a reader waits for a consistent state by default
+    constexpr std::chrono::milliseconds default_read_timeout{ 1000 };
+
+    inline std::system_error make_error(const char* what)
+    {
+        return std::system_error{ errno, std::generic_category(), what };
+    }
+
+    // maps a shared memory object into the address space of this process
+    inline void* map(int fd, std::size_t size, int protection)
+    {
+        void* address = ::mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            auto error = make_error("mmap");
+            ::close(fd);
+            throw error;
+        }
+        return address;
+    }
+}
+
+// an ordered set with a fixed capacity that stores its elements in a named
+// POSIX shared memory segment. the segment is created upon construction and
+// removed upon destruction of the set; readers that still have it mapped keep
+// a valid (but no longer updated) view.
+//
+// all modifications via insert, emplace and erase are published atomically to
+// readers. components that are modified in place, for example while iterating
+// with entities(...), must be modified within a write scope:
+//
+//     {
+//         auto scope = transforms.write();
+//         for (auto entity : entities(transforms, bodies)) { ... }
+//     }
+//
+// write scopes can be nested. readers cannot make progress while a scope is open,
+// so keep scopes around the modifications of a single system rather than around
+// a whole frame.
+template <class T>
+class shm_component_set {
+    static_assert(std::is_trivially_copyable<T>::value, "components in shared memory must be trivially copyable");
+
+public:
+    using value_type = T;
+    using key_type = T;
+    using size_type = std::size_t;
+    using reference = T&;
+    using const_reference = const T&;
+    using pointer = T*;
+    using const_pointer = const T*;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    // publishes modifications to readers when the outermost scope is destroyed
+    class write_scope {
+    public:
+        explicit write_scope(shm_component_set& set) noexcept
+            : set_{ &set }
+        {
+            set_->begin_write();
+        }
+
+        write_scope(write_scope&& rhs) noexcept
+            : set_{ rhs.set_ }
+        {
+            rhs.set_ = nullptr;
+        }
+
+        write_scope(const write_scope&) = delete;
+        write_scope& operator=(const write_scope&) = delete;
+
+        ~write_scope()
+        {
+            if (set_ != nullptr) {
+                set_->end_write();
+            }
+        }
+
+    private:
+        shm_component_set* set_;
+    };
+
+    // creates the named segment (e.g. "/world.transforms") with room for capacity elements.
+    // throws std::system_error with EEXIST if a segment with the same name exists, as it
+    // might be owned by another running process
+    shm_component_set(const std::string& name, size_type capacity)
+        : name_{ name },
+          capacity_{ capacity },
+          mapped_size_{ shm::segment_size<T>(capacity) }
+    {
+        create();
+    }
+
+    // creates the named segment and replaces an existing segment with the same name,
+    // e.g. one that was left behind by a crashed process
+    shm_component_set(shm::replace_existing_t, const std::string& name, size_type capacity)
+        : name_{ name },
+          capacity_{ capacity },
+          mapped_size_{ shm::segment_size<T>(capacity) }
+    {
+        ::shm_unlink(name_.c_str());
+        create();
+    }
+
+    shm_component_set(const shm_component_set&) = delete;
+    shm_component_set& operator=(const shm_component_set&) = delete;
+
+    ~shm_component_set()
+    {
+        ::munmap(header_, mapped_size_);
+        ::shm_unlink(name_.c_str());
+    }
+
+    // opens a scope in which elements can be modified in place
+    write_scope write()
+    {
+        return write_scope{ *this };
+    }
+
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    size_type size() const { return size_; }
+    size_type capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+    iterator lower_bound(const T& key)
+    {
+        return std::lower_bound(begin(), end(), key);
+    }
+
+    const_iterator lower_bound(const T& key) const
+    {
+        return std::lower_bound(begin(), end(), key);
+    }
+
+    iterator find(const T& key)
+    {
+        auto it = lower_bound(key);
+        return it != end() && !(key < *it) ? it : end();
+    }
+
+    const_iterator find(const T& key) const
+    {
+        auto it = lower_bound(key);
+        return it != end() && !(key < *it) ? it : end();
+    }
+
+    size_type count(const T& key) const
+    {
+        return find(key) != end() ? 1 : 0;
+    }
+
+    // inserts the element at its ordered position, unless an equivalent element exists.
+    // throws std::length_error if the set is at its capacity
+    std::pair<iterator, bool> insert(const T& x)
+    {
+        auto it = lower_bound(x);
+        if (it != end() && !(x < *it)) {
+            return { it, false };
+        }
+        if (size_ == capacity_) {
+            throw std::length_error("shm_component_set capacity exceeded");
+        }
+
+        auto scope = write();
+        std::memmove(it + 1, it, static_cast<std::size_t>(end() - it) * sizeof(T));
+        *it = x;
+        set_size(size_ + 1);
+        return { it, true };
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        return insert(T(std::forward<Args>(args)...));
+    }
+
+    iterator erase(const_iterator position)
+    {
+        auto it = begin() + (position - cbegin());
+        auto scope = write();
+        std::memmove(it, it + 1, static_cast<std::size_t>(end() - it - 1) * sizeof(T));
+        set_size(size_ - 1);
+        return it;
+    }
+
+    size_type erase(const T& key)
+    {
+        auto it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+
+    void clear()
+    {
+        auto scope = write();
+        set_size(0);
+    }
+
+private:
+    void create()
+    {
+        int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) {
+            throw shm::make_error("shm_open");
+        }
+        if (::ftruncate(fd, static_cast<off_t>(mapped_size_)) != 0) {
+            auto error = shm::make_error("ftruncate");
+            ::close(fd);
+            ::shm_unlink(name_.c_str());
+            throw error;
+        }
+        void* address = shm::map(fd, mapped_size_, PROT_READ | PROT_WRITE);
+        ::close(fd);
+
+        header_ = new (address) shm::segment_header{};
+        header_->magic = shm::segment_magic;
+        header_->element_size = sizeof(T);
+        header_->capacity = capacity_;
+        header_->sequence.store(0, std::memory_order_relaxed);
+        header_->size.store(0, std::memory_order_release);
+        data_ = reinterpret_cast<T*>(static_cast<char*>(address) + shm::data_offset<T>());
+    }
+
+    void begin_write() noexcept
+    {
+        if (write_depth_++ == 0) {
+            // an odd sequence number tells readers that a write is in progress
+            header_->sequence.store(sequence_ + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+    }
+
+    void end_write() noexcept
+    {
+        if (--write_depth_ == 0) {
+            sequence_ += 2;
+            header_->sequence.store(sequence_, std::memory_order_release);
+        }
+    }
+
+    void set_size(size_type size) noexcept
+    {
+        size_ = size;
+        header_->size.store(size, std::memory_order_relaxed);
+    }
+
+    std::string name_;
+    size_type capacity_;
+    std::size_t mapped_size_;
+    shm::segment_header* header_{ nullptr };
+    T* data_{ nullptr };
+
+    // process-local copies, such that the writer never has to read the shared header
+    size_type size_{ 0 };
+    std::uint64_t sequence_{ 0 };
+    int write_depth_{ 0 };
+};
+
+// a read-only view on the elements of a shared memory set at a single point in time.
+// the view can be used as a base set for entities(...)
+template <class T>
+class shm_component_span {
+public:
+    using value_type = T;
+    using key_type = T;
+    using size_type = std::size_t;
+    using iterator = const T*;
+    using const_iterator = const T*;
+
+    shm_component_span(const T* first, const T* last) noexcept
+        : first_{ first },
+          last_{ last }
+    {
+    }
+
+    const_iterator begin() const { return first_; }
+    const_iterator end() const { return last_; }
+    size_type size() const { return static_cast<size_type>(last_ - first_); }
+    bool empty() const { return first_ == last_; }
+
+    const_iterator find(const T& key) const
+    {
+        auto it = std::lower_bound(first_, last_, key);
+        return it != last_ && !(key < *it) ? it : last_;
+    }
+
+private:
+    const T* first_;
+    const T* last_;
+};
+
+// opens a shared memory set of another process read-only
+template <class T>
+class shm_component_reader {
+    static_assert(std::is_trivially_copyable<T>::value, "components in shared memory must be trivially copyable");
+
+public:
+    explicit shm_component_reader(const std::string& name)
+    {
+        int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            throw shm::make_error("shm_open");
+        }
+        struct stat status;
+        if (::fstat(fd, &status) != 0) {
+            auto error = shm::make_error("fstat");
+            ::close(fd);
+            throw error;
+        }
+        mapped_size_ = static_cast<std::size_t>(status.st_size);
+        if (mapped_size_ < sizeof(shm::segment_header)) {
+            ::close(fd);
+            throw std::runtime_error("shm_component_reader: segment too small");
+        }
+        void* address = shm::map(fd, mapped_size_, PROT_READ);
+        ::close(fd);
+
+        header_ = static_cast<const shm::segment_header*>(address);
+        if (header_->magic != shm::segment_magic || header_->element_size != sizeof(T)
+            || shm::segment_size<T>(header_->capacity) > mapped_size_) {
+            ::munmap(address, mapped_size_);
+            throw std::runtime_error("shm_component_reader: incompatible segment");
+        }
+        capacity_ = header_->capacity;
+        data_ = reinterpret_cast<const T*>(static_cast<const char*>(address) + shm::data_offset<T>());
+    }
+
+    shm_component_reader(const shm_component_reader&) = delete;
+    shm_component_reader& operator=(const shm_component_reader&) = delete;
+
+    ~shm_component_reader()
+    {
+        ::munmap(const_cast<shm::segment_header*>(header_), mapped_size_);
+    }
+
+    // calls f with a shm_component_span of the live elements and returns true if no
+    // write happened during the call. if false is returned, f may have observed torn
+    // elements (although never elements outside the segment) and its results must be
+    // discarded. f is not called at all while a write is in progress.
+    template <class F>
+    bool try_read(F&& f) const
+    {
+        auto sequence = header_->sequence.load(std::memory_order_acquire);
+        if (sequence % 2 != 0) {
+            return false;
+        }
+        auto size = std::min<std::size_t>(header_->size.load(std::memory_order_relaxed), capacity_);
+        f(shm_component_span<T>{ data_, data_ + size });
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return header_->sequence.load(std::memory_order_relaxed) == sequence;
+    }
+
+    // calls f with a shm_component_span of the live elements until f has observed
+    // a consistent state, backing off in between attempts. f must therefore be safe
+    // to call repeatedly. returns false if no consistent state was observed within
+    // the timeout
+    template <class F, class Rep, class Period>
+    bool read_for(F&& f, const std::chrono::duration<Rep, Period>& timeout) const
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        for (unsigned attempt = 0; !try_read(f); ++attempt) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            backoff(attempt);
+        }
+        return true;
+    }
+
+    template <class F>
+    bool read(F&& f) const
+    {
+        return read_for(std::forward<F>(f), shm::default_read_timeout);
+    }
+
+    // copies a consistent state of the elements into any ordered set type
+    // that can be constructed from an iterator range, such as component_set<T>.
+    // throws std::runtime_error if no consistent state was observed within the timeout
+    template <class TSet>
+    TSet copy() const
+    {
+        TSet result;
+        if (!read([&result](const shm_component_span<T>& span) {
+                result = TSet(span.begin(), span.end());
+            })) {
+            throw std::runtime_error("shm_component_reader: timeout while reading");
+        }
+        return result;
+    }
+
+private:
+    // yields for the first attempts, as writes are typically short, and then
+    // sleeps for an exponentially increasing time of at most a millisecond
+    static void backoff(unsigned attempt)
+    {
+        if (attempt < 16) {
+            std::this_thread::yield();
+        } else {
+            auto shift = std::min(attempt - 16, 10u);
+            std::this_thread::sleep_for(std::chrono::microseconds{ 1u << shift });
+        }
+    }
+
+    const shm::segment_header* header_{ nullptr };
+    const T* data_{ nullptr };
+    std::size_t mapped_size_{ 0 };
+    std::size_t capacity_{ 0 };
+};
+
+template <class T>
+struct is_union_base_set<shm_component_set<T> > {
+    static constexpr bool value = true;
+};
+
+template <class T>
+struct is_union_base_set<const shm_component_set<T> > {
+    static constexpr bool value = true;
+};
+
+template <class T>
+struct is_union_base_set<shm_component_span<T> > {
+    static constexpr bool value = true;
+};
+
+template <class T>
+struct is_union_base_set<const shm_component_span<T> > {
+    static constexpr bool value = true;
+};
+}
+
+#endif
@@ -0,0 +1,278 @@
+// Copyright (c) 2016 Bas Geertsema <mail@basgeertsema.nl>
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef ECS_SPATIAL_H_INCLUDED
+#define ECS_SPATIAL_H_INCLUDED
+
+#include "union_set.h"
+
+#include "ecs_flatset.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// a position in the plane of a spatial index
+struct spatial_point {
+    float x{ 0 };
+    float y{ 0 };
+};
+
+// functor to extract the position of a component for the spatial index
+// by default it calls the position() function on the component
+//
+// NOTE TO APPLICATION DEVELOPERS:
+//
+// you can either implement the position() function on your component types or
+// specialize this struct for your component type, e.g. to project 3D positions on the ground plane
+template <class T>
+struct element_position {
+    spatial_point operator()(const T& x) const
+    {
+        return x.position();
+    }
+};
+
+// a single result of a spatial query: the identifier and position of a component
+template <class TId>
+struct spatial_hit {
+    TId Id;
+    spatial_point Position;
+
+    bool operator<(const spatial_hit& rhs) const
+    {
+        return Id < rhs.Id;
+    }
+};
+
+template <class TId>
+struct element_id<spatial_hit<TId> > {
+    using type = TId;
+
+    type operator()(const spatial_hit<TId>& x) const
+    {
+        return x.Id;
+    }
+};
+
+// a secondary index over the positions of the components in a component set,
+// based on a uniform grid. the index is maintained incrementally: call update()
+// for every component that has moved (or was added) and erase() for every
+// component that was removed.
+//
+// the results of a query are ordered by identifier and can directly be used as a
+// base set in a union with other component sets, such as entities(hits, bodies).
+// because union iteration gallops through the larger sets, the cost of such a join
+// scales with the number of hits rather than with the size of the world.
+template <class T>
+class spatial_index {
+public:
+    using id_type = typename element_id<T>::type;
+    using hit_type = spatial_hit<id_type>;
+    using result_type = boost::container::flat_set<hit_type>;
+
+    // cell_size must be positive and is typically in the order of the most common query radius
+    explicit spatial_index(float cell_size)
+        : cell_size_{ cell_size }
+    {
+        assert(cell_size_ > 0);
+    }
+
+    // adds the component or moves it to its current position
+    void update(const T& x)
+    {
+        auto id = get_element_id(x);
+        auto position = element_position<T>{}(x);
+        auto key = cell_of(position);
+
+        auto location = locations_.find(id);
+        if (location != locations_.end()) {
+            if (location->second == key) {
+                // still in the same cell, only update the position
+                lower_bound(cells_.find(key)->second, id)->Position = position;
+                return;
+            }
+            erase_from_cell(location->second, id);
+            location->second = key;
+        } else {
+            locations_.emplace(id, key);
+        }
+
+        auto& entries = cells_[key];
+        entries.insert(lower_bound(entries, id), hit_type{ id, position });
+    }
+
+    // adds or moves all components in the range
+    template <class It>
+    void update(It first, It last)
+    {
+        for (; first != last; ++first) {
+            update(*first);
+        }
+    }
+
+    // removes the component with the given identifier from the index
+    void erase(id_type id)
+    {
+        auto location = locations_.find(id);
+        if (location == locations_.end()) {
+            return;
+        }
+        erase_from_cell(location->second, id);
+        locations_.erase(location);
+    }
+
+    // replaces the contents of the index with all components in the set
+    template <class TSet>
+    void rebuild(const TSet& set)
+    {
+        clear();
+        update(set.begin(), set.end());
+    }
+
+    void clear()
+    {
+        cells_.clear();
+        locations_.clear();
+    }
+
+    std::size_t size() const
+    {
+        return locations_.size();
+    }
+
+    // returns all components within the radius of the center, ordered by identifier
+    result_type query(spatial_point center, float radius) const
+    {
+        auto radius2 = radius * radius;
+        return query_box({ center.x - radius, center.y - radius }, { center.x + radius, center.y + radius },
+            [center, radius2](const hit_type& x) {
+                auto dx = x.Position.x - center.x;
+                auto dy = x.Position.y - center.y;
+                return dx * dx + dy * dy <= radius2;
+            });
+    }
+
+    // returns all components within the axis aligned box, ordered by identifier
+    result_type query_box(spatial_point min, spatial_point max) const
+    {
+        return query_box(min, max, [min, max](const hit_type& x) {
+            return x.Position.x >= min.x && x.Position.x <= max.x
+                && x.Position.y >= min.y && x.Position.y <= max.y;
+        });
+    }
+
+private:
+    using cell_key = std::int64_t;
+    using cell = std::vector<hit_type>;
+
+    template <class F>
+    result_type query_box(spatial_point min, spatial_point max, F&& contains) const
+    {
+        auto x0 = cell_coordinate(min.x);
+        auto x1 = cell_coordinate(max.x);
+        auto y0 = cell_coordinate(min.y);
+        auto y1 = cell_coordinate(max.y);
+
+        std::vector<hit_type> hits;
+        auto collect = [&hits, &contains](const cell& x) {
+            for (const auto& hit : x) {
+                if (contains(hit)) {
+                    hits.push_back(hit);
+                }
+            }
+        };
+
+        // visit the cells in the box, unless there are less occupied cells than that
+        auto box_cells = (static_cast<double>(x1) - x0 + 1) * (static_cast<double>(y1) - y0 + 1);
+        if (box_cells <= static_cast<double>(cells_.size())) {
+            // 64-bit counters, as the box may extend up to the outermost cells
+            for (std::int64_t x = x0; x <= x1; ++x) {
+                for (std::int64_t y = y0; y <= y1; ++y) {
+                    auto it = cells_.find(make_key(static_cast<std::int32_t>(x), static_cast<std::int32_t>(y)));
+                    if (it != cells_.end()) {
+                        collect(it->second);
+                    }
+                }
+            }
+        } else {
+            for (const auto& x : cells_) {
+                collect(x.second);
+            }
+        }
+
+        // a component is in a single cell only, so there are no duplicates
+        std::sort(hits.begin(), hits.end());
+        return result_type(boost::container::ordered_unique_range, hits.begin(), hits.end());
+    }
+
+    // positions beyond the range of cell coordinates end up in the outermost cells
+    std::int32_t cell_coordinate(float x) const
+    {
+        auto lowest = static_cast<double>(std::numeric_limits<std::int32_t>::min());
+        auto highest = static_cast<double>(std::numeric_limits<std::int32_t>::max());
+        auto coordinate = std::floor(static_cast<double>(x) / cell_size_);
+        return static_cast<std::int32_t>(std::min(highest, std::max(lowest, coordinate)));
+    }
+
+    static cell_key make_key(std::int32_t x, std::int32_t y)
+    {
+        return static_cast<cell_key>((static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32)
+            | static_cast<std::uint32_t>(y));
+    }
+
+    cell_key cell_of(spatial_point position) const
+    {
+        return make_key(cell_coordinate(position.x), cell_coordinate(position.y));
+    }
+
+    static typename cell::iterator lower_bound(cell& x, id_type id)
+    {
+        return std::lower_bound(x.begin(), x.end(), id, [](const hit_type& hit, const id_type& key) {
+            return hit.Id < key;
+        });
+    }
+
+    void erase_from_cell(cell_key key, id_type id)
+    {
+        auto it = cells_.find(key);
+        auto& x = it->second;
+        x.erase(lower_bound(x, id));
+        if (x.empty()) {
+            cells_.erase(it);
+        }
+    }
+
+    float cell_size_;
+    std::unordered_map<cell_key, cell> cells_;
+    std::unordered_map<id_type, cell_key> locations_;
+};
+}
+
+#endif
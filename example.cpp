@@ -19,10 +19,21 @@
 // SOFTWARE.
 
 #include "ecs.h"
+#include "ecs_hierarchy.h"
+#include "ecs_registry.h"
+#include "ecs_spatial.h"
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <limits>
 #include <set>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+// shared memory component sets are only available on POSIX systems
+#include "ecs_shm.h"
+#endif
 
 // for convenience use the entity-component-system namespace
 using namespace ecs;
@@ -57,6 +68,14 @@ struct ComponentBase {
         return Id;
     }
 
+    void set_id(int id)
+    {
+        // this function is used when entities are renumbered,
+        // e.g. by compact_ids, and can be overridden by
+        // specializing the ecs::assign_element_id functor
+        Id = id;
+    }
+
     // provide comparison operators because we use _ordered_ sets
     bool operator<(const ComponentBase& rhs) const
     {
@@ -124,6 +143,17 @@ struct element_id< ::Character> {
 };
 }
 
+namespace ecs {
+// the spatial index uses the ground plane (X and Z) of the Transform component
+template <>
+struct element_position< ::Transform> {
+    spatial_point operator()(const Transform& x) const
+    {
+        return { x.X, x.Z };
+    }
+};
+}
+
 // the functions below show how iterators convert
 // implicitly to components and subsets of entities
 
@@ -292,6 +322,187 @@ int main(int argc, char** argv)
         return get<Transform>(x).Y < 0.f;
     }) == 1);
 
+    // use any_of to iterate all entities that have at least one of the components
+    // every entity is visited exactly once and in the order of their id
+    {
+        std::vector<int> ids;
+        for (auto entity : any_of(bodies, characters)) {
+            // components that the entity does not have are returned as nullptr
+            RigidBody* body = get_if<RigidBody>(entity);
+            Character* character = get_if<Character>(entity);
+            assert(body != nullptr || character != nullptr);
+
+            // converting to a subset entity keeps the missing components as nullptr
+            ecs::entity<RigidBody> bodyOnly = entity;
+            assert(get_if<RigidBody>(bodyOnly) == body);
+            ids.push_back(body != nullptr ? body->Id : character->Id);
+        }
+        assert((ids == std::vector<int>{ 1, 2, 3 }));
+    }
+
+    // use entities_find_many to look up a batch of entities at once. the ids do not need
+    // to be sorted and the results are returned in the same order as the ids
+    {
+        std::vector<int> ids{ 3, 100, 1, 2 };
+        auto found = entities_find_many(ids, transforms, bodies);
+        assert(found.size() == ids.size());
+
+        // entity #3 has no RigidBody and entity #100 does not exist at all
+        assert(get_if<Transform>(found[0]) == nullptr && get_if<RigidBody>(found[0]) == nullptr);
+        assert(get_if<Transform>(found[1]) == nullptr);
+        assert(get<Transform>(found[2]).Id == 1 && get<RigidBody>(found[2]).Id == 1);
+        assert(get<Transform>(found[3]).X == 5.f);
+    }
+
+    // a spatial index finds the entities near a position without iterating all transforms
+    {
+        spatial_index<Transform> grid{ 10.f };
+        grid.rebuild(transforms);
+
+        // the index must be updated for components that have moved
+        auto moved = transforms.find({ 3 });
+        moved->X = 100.f;
+        grid.update(*moved);
+
+        // the hits are ordered by id, such that they can be used in a union with other sets
+        auto nearby = grid.query({ 0.f, 0.f }, 20.f);
+        assert(nearby.size() == 2);
+        assert(std::distance(entities_begin(nearby, bodies), entities_end(nearby, bodies)) == 2);
+        assert(grid.query({ 100.f, 8.f }, 1.f).size() == 1);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    // component sets can also live in shared memory, such that other processes
+    // (e.g. a debug viewer) can inspect the world while the simulation runs
+    {
+        // the name must be unique: creating a set fails if the segment already exists
+        const auto sharedName = "/ecsos.example." + std::to_string(::getpid()) + ".transforms";
+        shm_component_set<Transform> sharedTransforms{ sharedName, 1024 };
+        for (const auto& transform : transforms) {
+            sharedTransforms.insert(transform);
+        }
+
+        // components that are modified in place must be modified within a write scope
+        {
+            auto scope = sharedTransforms.write();
+            for (auto entity : entities(sharedTransforms, bodies)) {
+                get<Transform>(entity).Z = 0.f;
+            }
+        }
+
+        // typically the reader lives in another process. the read function is
+        // retried until it has seen a consistent state of the set or it times out
+        shm_component_reader<Transform> reader{ sharedName };
+        std::ptrdiff_t cnt = 0;
+        bool consistent = reader.read([&](const auto& view) {
+            cnt = std::distance(entities(view, bodies).begin(), entities(view, bodies).end());
+        });
+        assert(consistent && cnt == 2);
+        assert(reader.copy<component_set<Transform> >().size() == 3);
+    }
+#endif
+
+    // a hierarchy keeps parents before their children, such that transforms
+    // can be propagated from parents to children in a single pass
+    {
+        hierarchy<int> scene;
+        scene.insert(3);
+        scene.insert(1, 3);
+        scene.insert(2, 3);
+
+        // reparenting moves the entity including its children
+        scene.set_parent(2, 1);
+        assert(scene[scene.find(2)].Depth == 2);
+
+        // join resolves the transform of every node, in hierarchy order
+        auto nodes = scene.join(transforms_const);
+        std::vector<float> worldX(scene.size());
+        for (std::size_t i = 0; i < scene.size(); ++i) {
+            auto parent = scene[i].Parent;
+            worldX[i] = get<const Transform>(nodes[i]).X + (parent != scene.none ? worldX[parent] : 0.f);
+        }
+        assert(worldX[scene.find(2)] == 100.f + 2.f + 5.f);
+    }
+
+    // after a lot of spawning and despawning the entity ids can be compacted. all component
+    // sets are registered such that the ids are rewritten in all sets at once
+    {
+        // work on copies, the sets have value semantics
+        auto transformsCopy = transforms;
+        auto bodiesCopy = bodies;
+        auto charactersCopy = characters;
+
+        component_registry<int> registry;
+        registry.add(transformsCopy);
+        registry.add(bodiesCopy);
+        registry.add(charactersCopy);
+
+        // number the entities from 1 and order them by their X position from right to left.
+        // the ordering is called for every entity in any of the sets, so entities without
+        // a transform must be handled as well, here they are placed at the end
+        auto mapping = compact_ids(registry, [&](int id) {
+            auto transform = transformsCopy.find({ id });
+            return transform != transformsCopy.end() ? -transform->X : std::numeric_limits<float>::max();
+        }, 1);
+
+        // entity #3 has the largest X position and is now the first entity
+        assert(mapping(3) == 1);
+        assert(transformsCopy.begin()->X == 100.f);
+        assert(get<Character>(*entities_find(1, charactersCopy)).Archetype == "Warlord");
+        assert(std::distance(entities_begin(transformsCopy, bodiesCopy), entities_end(transformsCopy, bodiesCopy)) == 2);
+    }
+
+    // the registry also reports the memory used by each component set and
+    // can release the capacity that is no longer needed after despawning
+    {
+        auto bodiesCopy = bodies;
+        for (int id = 100; id < 10000; ++id) {
+            bodiesCopy.emplace_hint(bodiesCopy.end(), id, 1.f);
+        }
+        bodiesCopy.erase(bodiesCopy.find({ 100 }), bodiesCopy.end());
+
+        component_registry<int> registry;
+        registry.add(bodiesCopy);
+
+        auto report = registry.memory();
+        assert(report.components.front().size == 2);
+        assert(report.bytes_overhead() > 9000 * sizeof(RigidBody));
+
+        // shrinking happens only after a number of sync points to avoid reallocating
+        // sets that fluctuate in size, here we shrink at the first sync point
+        capacity_policy policy;
+        policy.shrink_delay = 1;
+        registry.set_capacity_policy(policy);
+        assert(registry.apply_capacity_policy() == 1);
+        assert(registry.memory().bytes_capacity() == policy.min_capacity * sizeof(RigidBody));
+    }
+
+#ifdef ECS_ENABLE_QUERY_STATS
+    // only complete walks are recorded, looking up a single entity is not
+    {
+        auto walks = [] {
+            std::uint64_t total = 0;
+            for (const auto& query : stats()) {
+                total += query.walks;
+            }
+            return total;
+        };
+        auto before = walks();
+        assert(entities_find(3, bodies, transforms) == entities_end(bodies, transforms));
+        auto it = entities_find(2, bodies, transforms);
+        ++it;
+        assert(it == entities_end(bodies, transforms));
+        assert(walks() == before);
+    }
+
+    // when instrumentation is enabled, each query (combination of component sets)
+    // records how many elements were visited in each set and how many matched
+    for (const auto& query : stats()) {
+        std::cout << query.signature << ": " << query.walks << " walks, "
+                  << query.matches << " matches, skip ratio " << query.skip_ratio() << std::endl;
+    }
+#endif
+
     std::cout << "ECSOS example finished" << std::endl;
 
     return 0;
@@ -23,8 +23,16 @@
 #ifndef UNION_SET_H_INCLUDED
 #define UNION_SET_H_INCLUDED
 
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <numeric>
 #include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "union_set_stats.h"
 
 namespace ecs {
 
@@ -155,11 +163,12 @@ struct union_set_el : public std::tuple<Types...> {
         return *(::std::get<T*>(*this));
     }
 
-    // constructor to create a tuple from a superset tuple
+    // constructor to create a tuple from a superset tuple. the pointers are copied
+    // as is, such that components that are not present remain a nullptr
     template <class... CTypes,
         typename = typename std::enable_if<meta::is_subset<typename union_set_el<CTypes...>::tuple_type, Types...>::value>::type>
     union_set_el(const union_set_el<CTypes...>& x)
-        : Base{ &*(std::get<Types>(x))... }
+        : Base{ std::get<Types>(x)... }
     {
     }
 };
@@ -185,6 +194,44 @@ inline T& get(union_set_el<Types...>&& x)
     return *(std::get<std::add_pointer_t<T> >(x));
 }
 
+// get a pointer to the value in the specified set in the union set element
+// returns a nullptr if the element is not present in that set, e.g. for elements yielded
+// by an any-of union (see union_any_iterator) or by union_find_many, and for subset
+// elements that have been converted from such elements
+template <class T, class... Types>
+inline T* get_if(const union_set_el<Types...>& x)
+{
+    return std::get<std::add_pointer_t<T> >(x);
+}
+
+// returns the first iterator in the ordered range [first, last) of which the element
+// identifier is not smaller than the key. the search gallops forward from first with
+// exponentially increasing steps and then does a binary search in the last step, so
+// that a series of increasing keys costs O(log d) per key, where d is the distance
+// to the previous result, instead of O(log N) for independent binary searches
+template <class It, class T>
+It gallop_lower_bound(It first, It last, const T& key)
+{
+    typename std::iterator_traits<It>::difference_type step = 1;
+    while (step < last - first && get_element_id(*(first + step)) < key) {
+        first += step;
+        step *= 2;
+    }
+
+    // the element at first + step (if any) is known to be at or beyond the key
+    auto bound = step < last - first ? first + step : last;
+    return std::lower_bound(first, bound, key, [](const auto& x, const T& k) {
+        return get_element_id(x) < k;
+    });
+}
+
+// tag to construct a union set iterator at the start of a walk over the sets, as
+// done by union_set::begin(). only such walks are recorded by union_set_probe
+struct union_set_walk_t {
+};
+
+constexpr union_set_walk_t union_set_walk{};
+
 // a forward iterator over a union set. the types specified are references.
 // the iterator holds a tuple of iterator pairs, which point
 // to the current value and and end in the invidiual sets.
@@ -192,16 +239,17 @@ inline T& get(union_set_el<Types...>&& x)
 // that is present in all sets, such that dereferencing is directly available.
 // upon dereferencing, a union_set_el object is created and returned. The union_set_el
 // holds the pointers to the values in the underlying sets.
+// when ECS_ENABLE_QUERY_STATS is defined, the walk is recorded by union_set_probe
 template <class... Types>
-struct union_set_iterator {
+struct union_set_iterator : protected union_set_probe<Types...> {
 
     // determine the type of the element identifier based on just the first set.
     // note that this assumes that all elements in all sets use the same type for the element identifier.
-    using element_id_type = typename element_id<std::tuple_element_t<0, std::tuple<typename Types::reference...> > >::type;
+    using element_id_type = typename element_id<std::tuple_element_t<0, std::tuple<typename std::iterator_traits<Types>::reference...> > >::type;
 
     // value_type is a union set selement
     // that holds pointers to all values in the underlying sets
-    using value_type = union_set_el<typename Types::pointer...>;
+    using value_type = union_set_el<typename std::iterator_traits<Types>::pointer...>;
 
     // constructs the iterator with iterator pairs for each set
     // upon construction the iterator is immediately advanced to the first
@@ -210,7 +258,15 @@ struct union_set_iterator {
     union_set_iterator(union_set_iterator_pair<Types>... args) noexcept
         : sets_{ std::make_tuple(args...) }
     {
-        start();
+        start(arity_t{});
+    }
+
+    // constructs the iterator at the start of a walk, which is recorded by the probe
+    union_set_iterator(union_set_walk_t, union_set_iterator_pair<Types>... args) noexcept
+        : sets_{ std::make_tuple(args...) }
+    {
+        this->probe_start(std::get<max_index()>(sets_).current != std::get<max_index()>(sets_).end);
+        start(arity_t{});
     }
 
     // upon dereferencing a union set selement is created that holds pointers
@@ -235,51 +291,136 @@ struct union_set_iterator {
     // advances to the next element that is present in all sets
     // if there is no such element, then it advances to the end position
     void operator++()
-    {            
-        // the iterator for the first set is always incremented to ensure
-        // at least a single advance within the sets
-        ++(std::get<max_index()>(sets_).current);
-
-        // advance an iterator until both iterators point
-        // at the same common id, or if any iterator points to the end
-        if (max_index() > 0 && std::get<max_index()>(sets_).current == std::get<max_index()>(sets_).end) {
-            // set all iterators to the end
-            advance_all_to_end();
-            return;
-        }
-        if (max_index() > 0) {
-            // get the current value identifier
-            max_ = get_element_id(*(std::get<max_index()>(sets_).current));
-
-            // now increment the others until a match is found for all sequences
-            // tag dispatch will ensure that this check does not happen at runtime for single sets
-            while (!advance_until<max_index()>(has_single_set)) {
-                // continue iterating over the sets
-            }
-        }
+    {
+        increment(arity_t{});
     }
 
 protected:
     using has_single_set_t = std::integral_constant<bool, sizeof...(Types) == 1>;
     static constexpr has_single_set_t has_single_set{};
 
+    // the iteration strategy is selected at compile time by tag dispatch on the number of sets:
+    // a single set is a plain walk, two sets are joined by a merge loop and three or more sets
+    // use the generic recursive search over all sets
+    using single_set_t = std::integral_constant<std::size_t, 1>;
+    using two_sets_t = std::integral_constant<std::size_t, 2>;
+    using many_sets_t = std::integral_constant<std::size_t, 3>;
+    using arity_t = std::integral_constant<std::size_t, (sizeof...(Types) < 3 ? sizeof...(Types) : 3)>;
+
     static constexpr size_t max_index()
     {
         return sizeof...(Types)-1;
     }
 
-    void start()
+    void start(single_set_t)
+    {
+        probe_position();
+    }
+
+    void increment(single_set_t)
+    {
+        ++std::get<0>(sets_).current;
+        this->probe_visit(0);
+        probe_position();
+    }
+
+    void start(two_sets_t)
+    {
+        merge();
+    }
+
+    void increment(two_sets_t)
+    {
+        ++std::get<1>(sets_).current;
+        this->probe_visit(1);
+        merge();
+    }
+
+    // advances both iterators until they point at the same identifier, or
+    // advances all iterators to the end if either of them reaches the end
+    void merge()
+    {
+        auto& first = std::get<0>(sets_);
+        auto& second = std::get<1>(sets_);
+        while (first.current != first.end && second.current != second.end) {
+            auto x = get_element_id(*first.current);
+            auto y = get_element_id(*second.current);
+            if (x < y) {
+                step_to<0>(y);
+            } else if (y < x) {
+                step_to<1>(x);
+            } else {
+                this->probe_match();
+                return;
+            }
+        }
+        advance_all_to_end();
+        this->probe_end();
+    }
+
+    // in a merge of two sets of similar density the next element is usually the one, so a
+    // single step is attempted first before falling back to galloping for sparse overlaps
+    template <size_t N>
+    void step_to(const element_id_type& key)
+    {
+        auto& x = std::get<N>(sets_);
+        ++x.current;
+        this->probe_visit(N);
+        if (x.current != x.end && get_element_id(*x.current) < key) {
+            advance_to<N>(key);
+        }
+    }
+
+    void start(many_sets_t)
     {
         // if any set is empty, then reset all sequences to the end
-        // due to tag dispatching, the check is only performed at runtime if there are indeed multiple sets
-        if (max_index() != 0 && any_at_end()) {
+        if (any_at_end()) {
             advance_all_to_end();
+            this->probe_end();
             return;
         }
-        max_ = std::get<max_index()>(sets_).current->Id;
-        if (!advance_until<max_index() - 1>(has_single_set)) {
+        max_ = get_element_id(*std::get<max_index()>(sets_).current);
+        if (!advance_until<max_index() - 1>(std::false_type{})) {
             // if the others have not the same elements, increase
-            operator++();
+            increment(arity_t{});
+        } else {
+            probe_position();
+        }
+    }
+
+    void increment(many_sets_t)
+    {
+        // the iterator for the last set is always incremented to ensure
+        // at least a single advance within the sets
+        ++(std::get<max_index()>(sets_).current);
+        this->probe_visit(max_index());
+
+        // advance an iterator until all iterators point
+        // at the same common id, or if any iterator points to the end
+        if (std::get<max_index()>(sets_).current == std::get<max_index()>(sets_).end) {
+            // set all iterators to the end
+            advance_all_to_end();
+            this->probe_end();
+            return;
+        }
+
+        // get the current value identifier
+        max_ = get_element_id(*(std::get<max_index()>(sets_).current));
+
+        // now increment the others until a match is found for all sequences
+        while (!advance_until<max_index()>(std::false_type{})) {
+            // continue iterating over the sets
+        }
+        probe_position();
+    }
+
+    // records either a match or the end of the walk for the current position
+    void probe_position()
+    {
+        if (std::get<max_index()>(sets_).current == std::get<max_index()>(sets_).end) {
+            this->probe_end();
+        } else {
+            this->probe_match();
         }
     }
 
@@ -323,11 +464,40 @@ protected:
         return at_end<max_index()>(has_single_set);
     }
 
+    // advances the iterator of a set to the first element that is not smaller than the key
+    template <size_t N>
+    void advance_to(const element_id_type& key)
+    {
+        using category = typename std::iterator_traits<std::tuple_element_t<N, std::tuple<Types...> > >::iterator_category;
+        advance_to<N>(key, category{});
+    }
+
+    // for random access iterators galloping ensures that a small set joined with a large
+    // set costs O(log d) per element instead of reading all d elements in between
+    template <size_t N>
+    void advance_to(const element_id_type& key, std::random_access_iterator_tag)
+    {
+        auto& x = std::get<N>(sets_);
+        auto next = gallop_lower_bound(x.current, x.end, key);
+        this->probe_visit(N, static_cast<std::size_t>(next - x.current));
+        x.current = next;
+    }
+
+    template <size_t N>
+    void advance_to(const element_id_type& key, std::forward_iterator_tag)
+    {
+        auto& x = std::get<N>(sets_);
+        while (x.current != x.end && get_element_id(*x.current) < key) {
+            ++x.current;
+            this->probe_visit(N);
+        }
+    }
+
     template <size_t N>
     bool advance_until(std::false_type)
     {
-        while (get_element_id(*std::get<N>(sets_).current) < max_) {
-            ++std::get<N>(sets_).current;
+        if (get_element_id(*std::get<N>(sets_).current) < max_) {
+            advance_to<N>(max_);
             if (std::get<N>(sets_).current == std::get<N>(sets_).end) {
                 advance_all_to_end();
                 return true;
@@ -358,6 +528,12 @@ union_set_iterator<Types...> make_union_set_iterator(union_set_iterator_pair<Typ
     return { args... };
 }
 
+template <class... Types>
+union_set_iterator<Types...> make_union_set_iterator(union_set_walk_t, union_set_iterator_pair<Types>... args)
+{
+    return { union_set_walk, args... };
+}
+
 // a union_set represents the union of one ore more base sets
 // elements within the sets are compared using the element_id functor to extract the identifier
 // the base sets are assumed to be ordered at all time!
@@ -392,7 +568,7 @@ struct union_set {
 
     auto begin()
     {
-        return make_union_set_iterator(
+        return make_union_set_iterator(union_set_walk,
             make_union_set_iterator_pair(
                 std::get<TSet*>(sets_)->begin(),
                 std::get<TSet*>(sets_)->end())...);
@@ -416,6 +592,257 @@ union_set<T...> make_union_set(T&... sets)
     return { sets... };
 }
 
+// a forward iterator over the any-of union of one or more sets, i.e. all elements
+// that are present in at least one of the sets. the sets are merged by their element
+// identifier so that every identifier is visited exactly once and in sorted order.
+// upon dereferencing, a union_set_el object is created that holds a pointer to the value
+// in each set, or a nullptr if the current identifier is not present in that set.
+// use get_if<T> to access the values of such an element.
+//
+// the merge keeps no state besides the iterator pairs and the current identifier. because
+// the number of sets is known at compile time, the smallest head is selected by an unrolled
+// comparison over all sets instead of a heap, which does not allocate and is faster for the
+// handful of sets that a system typically uses.
+template <class... Types>
+struct union_any_iterator {
+
+    // determine the type of the element identifier based on just the first set.
+    // note that this assumes that all elements in all sets use the same type for the element identifier.
+    using element_id_type = typename element_id<std::tuple_element_t<0, std::tuple<typename std::iterator_traits<Types>::reference...> > >::type;
+
+    // value_type is a union set element that holds pointers to the values
+    // in the underlying sets. pointers are null for sets that do not contain the element
+    using value_type = union_set_el<typename std::iterator_traits<Types>::pointer...>;
+
+    // constructs the iterator with iterator pairs for each set
+    // upon construction the iterator is positioned at the smallest
+    // identifier over all sets, or at the end if all sets are empty
+    union_any_iterator(union_set_iterator_pair<Types>... args) noexcept
+        : sets_{ std::make_tuple(args...) }
+    {
+        find_min<max_index()>(has_single_set);
+    }
+
+    // upon dereferencing a union set element is created that holds pointers to
+    // the values in the sets that contain the current identifier
+    value_type operator*()
+    {
+        return { pointer_if_current(std::get<union_set_iterator_pair<Types> >(sets_))... };
+    }
+
+    // equal when all corresponding iterators in all corresponding sets are equal
+    bool operator==(const union_any_iterator& rhs) const
+    {
+        return sets_ == rhs.sets_;
+    }
+
+    // not equal when any corresponding iterator in any corresponding set is not equal
+    bool operator!=(const union_any_iterator& rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+    // advances every set that holds the current identifier and
+    // selects the smallest identifier over the remaining heads
+    void operator++()
+    {
+        advance_current<max_index()>(has_single_set);
+        find_min<max_index()>(has_single_set);
+    }
+
+protected:
+    using has_single_set_t = std::integral_constant<bool, sizeof...(Types) == 1>;
+    static constexpr has_single_set_t has_single_set{};
+
+    static constexpr size_t max_index()
+    {
+        return sizeof...(Types)-1;
+    }
+
+    template <class T>
+    bool is_current(const union_set_iterator_pair<T>& x) const
+    {
+        // heads are never smaller than the current identifier
+        return x.current != x.end && !(min_ < get_element_id(*x.current));
+    }
+
+    template <class T>
+    auto pointer_if_current(const union_set_iterator_pair<T>& x) const
+        -> typename std::iterator_traits<T>::pointer
+    {
+        return is_current(x) ? &*x.current : nullptr;
+    }
+
+    template <size_t N>
+    void advance_current(std::true_type)
+    {
+        static_assert(N == 0, "terminating");
+        if (is_current(std::get<N>(sets_))) {
+            ++std::get<N>(sets_).current;
+        }
+    }
+
+    template <size_t N>
+    void advance_current(std::false_type)
+    {
+        static_assert(N > 0, "non terminating");
+        if (is_current(std::get<N>(sets_))) {
+            ++std::get<N>(sets_).current;
+        }
+        advance_current<N - 1>(std::integral_constant<bool, (N - 1) == 0>{});
+    }
+
+    template <size_t N>
+    void update_min()
+    {
+        auto& x = std::get<N>(sets_);
+        if (x.current != x.end && (!has_min_ || get_element_id(*x.current) < min_)) {
+            min_ = get_element_id(*x.current);
+            has_min_ = true;
+        }
+    }
+
+    template <size_t N>
+    void find_min(std::true_type)
+    {
+        static_assert(N == 0, "terminating");
+        has_min_ = false;
+        update_min<N>();
+    }
+
+    template <size_t N>
+    void find_min(std::false_type)
+    {
+        static_assert(N > 0, "non terminating");
+        find_min<N - 1>(std::integral_constant<bool, (N - 1) == 0>{});
+        update_min<N>();
+    }
+
+    element_id_type min_{};
+    bool has_min_{ false };
+    std::tuple<union_set_iterator_pair<Types>...> sets_;
+};
+
+template <class... Types>
+union_any_iterator<Types...> make_union_any_iterator(union_set_iterator_pair<Types>... args)
+{
+    return { args... };
+}
+
+// a union_any_set represents the any-of union of one or more base sets, i.e. all
+// elements that are present in at least one of the sets
+// elements within the sets are compared using the element_id functor to extract the identifier
+// the base sets are assumed to be ordered at all time!
+template <class... TSet>
+struct union_any_set {
+    union_any_set(TSet&... sets)
+    {
+        // store pointers to the sets in a tuple
+        sets_ = std::make_tuple((&sets)...);
+    }
+
+    auto begin()
+    {
+        return make_union_any_iterator(
+            make_union_set_iterator_pair(
+                std::get<TSet*>(sets_)->begin(),
+                std::get<TSet*>(sets_)->end())...);
+    }
+
+    auto end()
+    {
+        return make_union_any_iterator(
+            make_union_set_iterator_pair(
+                std::get<TSet*>(sets_)->end(),
+                std::get<TSet*>(sets_)->end())...);
+    }
+
+private:
+    std::tuple<std::add_pointer_t<TSet>...> sets_;
+};
+
+template <class... T>
+union_any_set<T...> make_union_any_set(T&... sets)
+{
+    return { sets... };
+}
+
+// resolves a batch of identifiers against the union of one or more sets.
+// the queries are sorted (if they are not already) such that each set is resolved
+// in a single forward pass, rather than a binary search per identifier per set.
+// the results are in the original order of the queries. identifiers that are not
+// present in all sets result in an element of which all pointers are null
+template <class... TSet>
+struct union_find_many_query {
+    using value_type = union_set_el<typename std::iterator_traits<decltype(std::declval<TSet&>().begin())>::pointer...>;
+
+    template <class TIds>
+    static std::vector<value_type> resolve(const TIds& ids, TSet&... sets)
+    {
+        auto first = std::begin(ids);
+        auto count = static_cast<std::size_t>(std::distance(first, std::end(ids)));
+
+        // only sort a permutation of the queries, the ids themselves are left untouched
+        std::vector<std::size_t> order;
+        if (!std::is_sorted(first, std::end(ids))) {
+            order.resize(count);
+            std::iota(order.begin(), order.end(), std::size_t{ 0 });
+            std::sort(order.begin(), order.end(), [first](std::size_t a, std::size_t b) {
+                return first[a] < first[b];
+            });
+        }
+
+        return resolve(ids, order, sets...);
+    }
+
+    // resolves the identifiers in the order of a permutation that sorts them, which
+    // allows callers that query the same identifiers repeatedly to sort them only once.
+    // an empty permutation indicates that the identifiers are already sorted
+    template <class TIds>
+    static std::vector<value_type> resolve(const TIds& ids, const std::vector<std::size_t>& order, TSet&... sets)
+    {
+        auto first = std::begin(ids);
+        std::vector<value_type> result(static_cast<std::size_t>(std::distance(first, std::end(ids))));
+        resolve_sets(first, order, result, std::index_sequence_for<TSet...>{}, sets...);
+        return result;
+    }
+
+protected:
+    template <class It, std::size_t... I>
+    static void resolve_sets(It ids, const std::vector<std::size_t>& order, std::vector<value_type>& result, std::index_sequence<I...>, TSet&... sets)
+    {
+        // the sets are resolved one after the other. expansion within a braced
+        // initializer list guarantees this left to right evaluation order
+        using expander = int[];
+        (void)expander{ 0, (resolve_set<I>(ids, order, result, sets), 0)... };
+    }
+
+    template <std::size_t I, class It, class T>
+    static void resolve_set(It ids, const std::vector<std::size_t>& order, std::vector<value_type>& result, T& set)
+    {
+        auto current = set.begin();
+        const auto end = set.end();
+        for (std::size_t n = 0; n < result.size(); ++n) {
+            auto index = order.empty() ? n : order[n];
+            auto& x = result[index];
+
+            // skip identifiers that are already missing in one of the previous sets,
+            // such elements have been reset so it suffices to check the first set
+            if (I > 0 && std::get<0>(x) == nullptr) {
+                continue;
+            }
+
+            const auto& key = ids[index];
+            current = gallop_lower_bound(current, end, key);
+            if (current != end && !(key < get_element_id(*current))) {
+                std::get<I>(x) = &*current;
+            } else {
+                x = value_type{};
+            }
+        }
+    }
+};
+
 // below are various free standing functions for ease of use
 
 // ensure via SFINAE that only boost flatsets are accepted here
@@ -443,6 +870,18 @@ auto union_find(T id, Types&... sets)
 {
     return make_union_set(sets...).find(id);
 }
+
+template <class TIds, class... Types, typename = std::enable_if_t<meta::is_allowed_container<Types...>::value> >
+auto union_find_many(const TIds& ids, Types&... sets)
+{
+    return union_find_many_query<Types...>::resolve(ids, sets...);
+}
+
+template <class... Types, typename = std::enable_if_t<meta::is_allowed_container<Types...>::value> >
+auto union_any_of(Types&... sets)
+{
+    return make_union_any_set(sets...);
+}
 }
 
 namespace std {
@@ -454,6 +893,15 @@ struct iterator_traits<ecs::union_set_iterator<Types...> > {
     using reference = std::add_lvalue_reference<value_type>;
     using iterator_category = std::forward_iterator_tag;
 };
+
+template <class... Types>
+struct iterator_traits<ecs::union_any_iterator<Types...> > {
+    using difference_type = size_t;
+    using value_type = typename ecs::union_any_iterator<Types...>::value_type;
+    using pointer = std::add_pointer_t<value_type>;
+    using reference = std::add_lvalue_reference_t<value_type>;
+    using iterator_category = std::forward_iterator_tag;
+};
 }
 
 #endif
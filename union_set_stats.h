@@ -0,0 +1,384 @@
+// Copyright (c) 2016 Bas Geertsema <mail@basgeertsema.nl>
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef UNION_SET_STATS_H_INCLUDED
+#define UNION_SET_STATS_H_INCLUDED
+
+// instrumentation of union set iteration
+//
+// when ECS_ENABLE_QUERY_STATS is defined, every complete walk of a union set
+// iterator (from begin() up to the end) is recorded per query signature, i.e.
+// per combination of component types. the statistics are available via ecs::stats()
+// and can be written as JSON or as a Chrome trace (chrome://tracing).
+//
+// only complete walks are recorded. walks that stop before the end, such as a
+// loop with a break, std::find_if or a find() on a union, are not counted at all,
+// as iterators are freely copied and a walk has no other well-defined end.
+//
+// when ECS_ENABLE_QUERY_STATS is not defined, the probe in the iterator is an empty
+// base class with empty inline functions, such that there is no overhead at all.
+// ecs::stats() is then still available but always returns an empty snapshot.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#if defined(__GNUG__)
+#include <cstdlib>
+#include <cxxabi.h>
+#endif
+
+#ifdef ECS_ENABLE_QUERY_STATS
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <mutex>
+#endif
+
+namespace ecs {
+
+// the statistics of all walks of a single query signature
+struct query_stats {
+    // the component types of the query, in the order of the sets
+    std::string signature;
+
+    // number of complete walks over the query
+    std::uint64_t walks{ 0 };
+
+    // number of elements yielded over all walks
+    std::uint64_t matches{ 0 };
+
+    // number of elements that the iterator advanced over in each base set. for
+    // random access sets this includes the elements skipped by galloping
+    std::vector<std::uint64_t> visited;
+
+    // wall time from the start to the end of all walks, this includes
+    // the time spent by the application on each yielded element
+    std::chrono::nanoseconds time{ 0 };
+
+    std::uint64_t visited_total() const
+    {
+        std::uint64_t total = 0;
+        for (auto x : visited) {
+            total += x;
+        }
+        return total;
+    }
+
+    // the fraction of visited elements that did not end up in a match.
+    // a high ratio indicates a large skew between the sizes of the sets
+    double skip_ratio() const
+    {
+        auto total = visited_total();
+        auto matched = matches * visited.size();
+        return total == 0 || matched >= total ? 0.0 : static_cast<double>(total - matched) / static_cast<double>(total);
+    }
+};
+
+namespace meta {
+    // returns the readable (demangled where supported) name of a type
+    inline std::string type_name(const std::type_info& type)
+    {
+#if defined(__GNUG__)
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+        if (status == 0 && demangled != nullptr) {
+            std::string result{ demangled };
+            std::free(demangled);
+            return result;
+        }
+#endif
+        return type.name();
+    }
+}
+
+namespace stats_detail {
+    // writes a string as a JSON string literal
+    inline void write_json_string(std::ostream& os, const std::string& x)
+    {
+        os << '"';
+        for (auto c : x) {
+            if (c == '"' || c == '\\') {
+                os << '\\';
+            }
+            os << c;
+        }
+        os << '"';
+    }
+
+    inline void write_json_stats(std::ostream& os, const query_stats& x)
+    {
+        os << "{\"signature\":";
+        write_json_string(os, x.signature);
+        os << ",\"walks\":" << x.walks << ",\"matches\":" << x.matches << ",\"visited\":[";
+        for (std::size_t i = 0; i < x.visited.size(); ++i) {
+            os << (i > 0 ? "," : "") << x.visited[i];
+        }
+        os << "],\"skip_ratio\":" << x.skip_ratio() << ",\"time_ns\":" << x.time.count() << "}";
+    }
+
+    // writes a duration in microseconds with a fixed precision of nanoseconds,
+    // as the Chrome trace format expects timestamps in microseconds
+    inline void write_json_microseconds(std::ostream& os, std::chrono::nanoseconds x)
+    {
+        auto ns = x.count();
+        if (ns < 0) {
+            os << '-';
+            ns = -ns;
+        }
+        auto fraction = std::to_string(ns % 1000);
+        os << ns / 1000 << '.' << std::string(3 - fraction.size(), '0') << fraction;
+    }
+
+    // a single walk, as recorded for the Chrome trace
+    struct trace_event {
+        std::size_t query;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::nanoseconds duration;
+        std::uint64_t matches;
+        std::uint64_t visited;
+    };
+
+#ifdef ECS_ENABLE_QUERY_STATS
+    // limits the memory used for the Chrome trace, later walks are only aggregated
+    constexpr std::size_t max_trace_events = 1 << 16;
+
+    // holds the statistics of all queries of the process
+    class registry {
+    public:
+        std::size_t register_query(std::string signature, std::size_t sets)
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+
+            // queries over const and non-const sets of the same types share their statistics
+            for (std::size_t i = 0; i < queries_.size(); ++i) {
+                if (queries_[i].signature == signature) {
+                    return i;
+                }
+            }
+
+            query_stats x;
+            x.signature = std::move(signature);
+            x.visited.resize(sets);
+            queries_.push_back(std::move(x));
+            return queries_.size() - 1;
+        }
+
+        void record(std::size_t query, const std::uint64_t* visited, std::uint64_t matches,
+            std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            auto& x = queries_[query];
+            std::uint64_t total = 0;
+            for (std::size_t i = 0; i < x.visited.size(); ++i) {
+                x.visited[i] += visited[i];
+                total += visited[i];
+            }
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+            ++x.walks;
+            x.matches += matches;
+            x.time += duration;
+
+            if (events_.size() < max_trace_events) {
+                events_.push_back({ query, start, duration, matches, total });
+            }
+        }
+
+        std::vector<query_stats> queries() const
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            return queries_;
+        }
+
+        std::vector<trace_event> events() const
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            return events_;
+        }
+
+        void reset()
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            for (auto& x : queries_) {
+                x.walks = 0;
+                x.matches = 0;
+                x.time = std::chrono::nanoseconds{ 0 };
+                std::fill(x.visited.begin(), x.visited.end(), 0);
+            }
+            events_.clear();
+        }
+
+    private:
+        mutable std::mutex mutex_;
+        std::vector<query_stats> queries_;
+        std::vector<trace_event> events_;
+    };
+
+    inline registry& global_registry()
+    {
+        static registry instance;
+        return instance;
+    }
+
+    template <class... T>
+    std::string signature()
+    {
+        std::string result;
+        using expander = int[];
+        (void)expander{ 0, (result += (result.empty() ? "" : ", ") + meta::type_name(typeid(T)), 0)... };
+        return result;
+    }
+#endif
+}
+
+#ifdef ECS_ENABLE_QUERY_STATS
+
+// records the walk of a union set iterator over sets with the given iterator types
+template <class... Types>
+class union_set_probe {
+protected:
+    // starts a walk if the iterator is not constructed at the end
+    void probe_start(bool active)
+    {
+        active_ = active;
+        if (active_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    // the iterator has advanced over a number of elements in the set with the given index
+    void probe_visit(std::size_t set, std::size_t count = 1)
+    {
+        visited_[set] += count;
+    }
+
+    // the iterator has found an element that is present in all sets
+    void probe_match()
+    {
+        ++matches_;
+    }
+
+    // the iterator has reached the end, the walk is recorded once
+    void probe_end()
+    {
+        if (active_) {
+            active_ = false;
+            stats_detail::global_registry().record(query(), visited_.data(), matches_, start_, std::chrono::steady_clock::now());
+        }
+    }
+
+private:
+    static std::size_t query()
+    {
+        static const std::size_t index = stats_detail::global_registry().register_query(
+            stats_detail::signature<typename std::iterator_traits<Types>::value_type...>(), sizeof...(Types));
+        return index;
+    }
+
+    bool active_{ false };
+    std::uint64_t matches_{ 0 };
+    std::array<std::uint64_t, sizeof...(Types)> visited_{};
+    std::chrono::steady_clock::time_point start_;
+};
+
+// returns a snapshot of the statistics of all queries that have been walked so far
+inline std::vector<query_stats> stats()
+{
+    return stats_detail::global_registry().queries();
+}
+
+// clears the statistics of all queries
+inline void reset_stats()
+{
+    stats_detail::global_registry().reset();
+}
+
+#else
+
+template <class... Types>
+class union_set_probe {
+protected:
+    void probe_start(bool) {}
+    void probe_visit(std::size_t, std::size_t = 1) {}
+    void probe_match() {}
+    void probe_end() {}
+};
+
+inline std::vector<query_stats> stats()
+{
+    return {};
+}
+
+inline void reset_stats()
+{
+}
+
+#endif
+
+// writes the statistics of all queries as a JSON array
+inline void write_stats_json(std::ostream& os)
+{
+    auto queries = stats();
+    os << "[";
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        os << (i > 0 ? "," : "");
+        stats_detail::write_json_stats(os, queries[i]);
+    }
+    os << "]";
+}
+
+// writes every recorded walk as a complete event in the Chrome trace event format,
+// with the aggregated statistics of all queries as metadata
+inline void write_stats_chrome_trace(std::ostream& os)
+{
+    os << "{\"traceEvents\":[";
+#ifdef ECS_ENABLE_QUERY_STATS
+    auto queries = stats();
+    auto events = stats_detail::global_registry().events();
+
+    // events are recorded when a walk ends, so nested walks are not ordered by their start
+    auto epoch = std::chrono::steady_clock::time_point::max();
+    for (const auto& x : events) {
+        epoch = std::min(epoch, x.start);
+    }
+    for (std::size_t i = 0; i < events.size(); ++i) {
+        const auto& x = events[i];
+        os << (i > 0 ? "," : "") << "{\"name\":";
+        stats_detail::write_json_string(os, queries[x.query].signature);
+        os << ",\"cat\":\"ecs\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":";
+        stats_detail::write_json_microseconds(os, std::chrono::duration_cast<std::chrono::nanoseconds>(x.start - epoch));
+        os << ",\"dur\":";
+        stats_detail::write_json_microseconds(os, x.duration);
+        os << ",\"args\":{\"matches\":" << x.matches << ",\"visited\":" << x.visited << "}}";
+    }
+#endif
+    os << "],\"queries\":";
+    write_stats_json(os);
+    os << "}";
+}
+}
+
+#endif